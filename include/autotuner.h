@@ -0,0 +1,38 @@
+#ifndef AUTOTUNER_H
+#define AUTOTUNER_H
+
+#include "config.h"
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Searches for the number of stages and the pipeline capacity that give the 
+// highest throughput for the per stage delays of a configuration. 
+class AutoTuner {
+  public:
+    Config * config;
+
+    // A candidate still running after earlyTerminationFactor times the time 
+    // of the best candidate so far is clearly losing and gets abandoned.
+    double const earlyTerminationFactor = 1.5;
+    int const maxEvaluations = 48;
+
+    // Candidates are keyed by the number of stages and the pipeline capacity.
+    // The value is the throughput of the candidate, or 0 if it was abandoned.
+    std::map< std::pair< int, int >, double > evaluated;
+    std::pair< int, int > best = std::make_pair( 0, 0 );
+    double bestDuration = 0;
+
+    std::vector< int > mergedDelays( int numStages );
+    Config candidateConfig( int numStages, int capacity );
+    double evaluate( int numStages, int capacity );
+    int maxCapacity( int numStages );
+    void refineStages( int low, int high );
+    void refineCapacity( int low, int high );
+    void autoTuneMain( std::string outputFileName );
+
+    AutoTuner( Config * config );
+};
+
+#endif
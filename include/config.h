@@ -4,6 +4,23 @@
 #include <string>
 #include <vector>
 #include <sstream>
+#include <utility>
+
+// How a stage hands its output batch to the stages on its outgoing edges.
+// Broadcast edges each receive the full batch, split edges share the batch
+// evenly, and round robin edges take turns receiving the whole batch.
+enum class Routing { Broadcast, Split, RoundRobin };
+
+// How a stage with several incoming edges combines them. Merge processes 
+// whatever arrived on any edge, sync waits for items on every edge and pairs
+// them up.
+enum class JoinMode { Merge, Sync };
+
+struct Edge {
+    int from;
+    int to;
+    Routing routing;
+};
 
 class Config {
   private:
@@ -15,22 +32,43 @@ class Config {
     std::string configFileName_;
     int visitedBitMap = 0;
     bool skipNoPipeline_ = false;
+    bool virtualTime_ = false;
+    bool busyWait_ = false;
+    int metricsInterval_ = 0;
+    std::vector< Edge > edges_ = std::vector< Edge >();
+    std::vector< JoinMode > joinModes_ = std::vector< JoinMode >();
+    std::vector< std::pair< int, JoinMode > > joinSpecs_;
     void visit( std::istringstream & iss, int lineNum );
     void visitNumStages( std::istringstream & iss, int lineNum );
     void visitNumWorkItems( std::istringstream & iss, int lineNum );
     void visitMaxPipelineCapacity( std::istringstream & iss, int lineNum );
     void visitBaseDelay( std::istringstream & iss, int lineNum );
     void visitImbalanceFactor( std::istringstream & iss, int lineNum );
+    void visitEdge( std::istringstream & iss, int lineNum );
+    void visitJoin( std::istringstream & iss, int lineNum );
+    void visitMetricsInterval( std::istringstream & iss, int lineNum );
+    void verifyTopology();
     void verifySemantics();
   public:
     Config( char * configFileName );
     void parseConfigFile();
+    void reshape( int numStages, int maxPipelineCapacity, int baseDelay,
+            std::vector< int > imbalanceFactor );
+    void writeConfigFile( std::string fileName );
     int numStages();
     int numWorkItems();
     int maxPipelineCapacity();
     int baseDelay();
     std::vector< int > imbalanceFactor();
     bool skipNoPipeline();
+    bool virtualTime();
+    void useVirtualTime();
+    bool busyWait();
+    void useBusyWait();
+    int metricsInterval();
+    std::vector< Edge > edges();
+    std::vector< JoinMode > joinModes();
+    bool customTopology();
 };
 
 #endif
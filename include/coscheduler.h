@@ -0,0 +1,30 @@
+#ifndef COSCHEDULER_H
+#define COSCHEDULER_H
+
+#include "config.h"
+#include "simulator.h"
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+// Runs several independent pipelines on the same machine at the same time, to
+// see how much they slow each other down compared to running alone.
+class CoScheduler {
+  public:
+    std::vector< std::string > configFileNames;
+    std::vector< Config > configs;
+    std::vector< Simulator > simulators;
+    std::vector< double > durationsAlone;
+    std::vector< pthread_t > TID;
+    pthread_barrier_t startBarrier;
+
+    int totalStageThreads();
+    void runAlone();
+    void runTogether();
+    void report( double makespan );
+    void coScheduleMain();
+
+    CoScheduler( std::vector< char * > configFileNames );
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <pthread.h>
+#include <string>
+#include <time.h>
+
+// Each block below takes up whole cache lines, so that no two stage threads
+// ever write to the same cache line.
+int const cacheLineSize = 64;
+
+// The layout of the shared memory block is one MetricsHeader followed by one
+// StageMetrics per stage. External tools can map the block read only and poll
+// it while the simulation runs.
+struct alignas( cacheLineSize ) MetricsHeader {
+    // Incremented by the stats thread every time it publishes a snapshot.
+    std::atomic< long long > snapshots;
+    std::atomic< long long > elapsedNanos;
+    // 0 for the non pipelined run, 1 for the pipelined run.
+    std::atomic< int > phase;
+    int numStages;
+};
+
+struct alignas( cacheLineSize ) StageMetrics {
+    std::atomic< long long > itemsProcessed;
+    std::atomic< long long > currentBatch;
+    std::atomic< long long > barrierWaitNanos;
+};
+
+// Per stage counters that stay readable while a simulation is running. The 
+// stage threads only ever do relaxed atomic stores and increments, and a 
+// separate stats thread periodically publishes a snapshot of the counters.
+class Metrics {
+  public:
+    int numStages;
+    int intervalMs;
+    std::string shmName;
+    size_t size;
+    bool shared = false;
+    MetricsHeader * header;
+    StageMetrics * stages;
+    struct timespec startTime;
+
+    pthread_t statsThread;
+    pthread_mutex_t mutex;
+    pthread_cond_t stopCondition;
+    bool running = false;
+
+    void start();
+    void stop();
+    void beginPhase( int phase );
+    void publish();
+    void statsLoop();
+
+    // The hot path, called from the stage threads.
+    void startBatch( int stage, int items ) {
+        stages[ stage ].currentBatch.store( items, std::memory_order_relaxed );
+    }
+    void finishBatch( int stage, int items ) {
+        stages[ stage ].itemsProcessed.fetch_add( items, 
+                std::memory_order_relaxed );
+    }
+    void addBarrierWait( int stage, long long nanos ) {
+        stages[ stage ].barrierWaitNanos.fetch_add( nanos, 
+                std::memory_order_relaxed );
+    }
+
+    Metrics( int numStages, int intervalMs );
+    ~Metrics();
+};
+
+long long nanosSince( struct timespec & start );
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef PERFTEST_H
+#define PERFTEST_H
+
+#include <string>
+#include <vector>
+
+// The golden numbers for one configuration, and what the latest run got.
+struct PerfResult {
+    std::string configFileName;
+    double baselineThroughput;
+    double baselineSpeedup;
+    int baselineControlIterations;
+    double tolerance;
+    double throughput = 0;
+    double speedup = 0;
+    int controlIterations = 0;
+    int itemsProcessed = 0;
+    int numWorkItems = 0;
+    bool passed = true;
+};
+
+// Runs a fixed set of configurations in virtual time and compares the results
+// against stored baselines, so that performance regressions fail the build.
+class PerfTest {
+  public:
+    std::string baselineFileName;
+    std::vector< PerfResult > results;
+
+    void parseBaselineFile();
+    void runConfig( PerfResult & result );
+    void writeResultsFile( std::string fileName, std::string revision );
+    int perfTestMain( std::string resultsFileName, std::string revision );
+
+    PerfTest( std::string baselineFileName );
+};
+
+#endif
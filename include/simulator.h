@@ -2,6 +2,8 @@
 #define SIMULATOR_H
 
 #include "config.h"
+#include "topology.h"
+#include "metrics.h"
 #include <queue>
 #include <chrono>
 #include <vector>
@@ -11,6 +13,7 @@
 class Simulator {
   public:
     Config * config;
+    Topology topology;
     int const controlThread = 0;
     int const microSecondMultiplier = 1000;
     int const falseSharingPreventionBuffer = 10;
@@ -19,28 +22,74 @@ class Simulator {
     std::chrono::duration< double, std::milli > durationNonPipelined;
     bool debug = false;
 
+    // Runs still going once they have used up their time budget are 
+    // abandoned and marked as aborted. In virtual time the budget is spent in
+    // virtual time as well, otherwise each run sets its deadline when it 
+    // starts.
+    std::chrono::duration< double, std::milli > timeBudget = 
+        std::chrono::duration< double, std::milli >::max();
+    std::chrono::high_resolution_clock::time_point deadline = 
+        std::chrono::high_resolution_clock::time_point::max();
+    bool aborted = false;
+
+    // Time in nano seconds that has passed in virtual time, and the virtual 
+    // time each stage spent processing its current batch.
+    long long virtualClock = 0;
+    std::vector< long long > stageVirtualTime;
+    int controlIterations = 0;
+
+    // Only set while live metrics are being published.
+    Metrics * metrics = nullptr;
+
     std::queue< int > workItems = std::queue< int >();
     std::vector< int > stageInputs;
     std::vector< int > stageOutputs;
     std::vector< pthread_t > TID;
     std::vector< struct timespec > timespecs;
     std::vector< int > controlSignals;
+    std::vector< int > edgePending;
+    std::vector< int > roundRobinCursors;
+    std::vector< int > splitCursors;
+    std::vector< int > stageItemsProcessed;
     pthread_barrier_t barrier;
     bool leaveEventLoop = false;
 
     
     void setUpWorkQueueForConfig( bool pipe );
     void noPipelinerSimulation();
+    bool runStageSequentially( int stage, int items );
     void simulatorMain();
+    void runSimulations();
+    void waitAtBarrier( int tid );
+    void pipelinerSimulation();
+    void timePipelinedRun();
+    bool hasDeadline();
+    bool pastDeadline();
+    void startDeadline( std::chrono::high_resolution_clock::time_point start );
     void dumpDebugInfo( int state );
     void simulateStage( int tid );
     void controlPipeline();
     void resetControlSignals();
     void setUpTimeSpecs();
     void noPipelinerDriver( bool shortCircuit );
+    std::chrono::duration< double, std::milli > timeNoPipelinerSimulation();
+    void resetVirtualTime();
+    std::chrono::duration< double, std::milli > virtualDuration();
+    void processWorkItems( int stage, int items );
+    void resetRouting();
+    void routeStageOutput( int stage, int items );
+    int gatherStageInput( int stage );
+    bool upstreamDone( int stage );
+    void reportCriticalPath();
 
     Simulator( Config * config );
 };
 
+// The argument passed to each stage thread of the pipelined run.
+struct StageThreadArgs {
+    Simulator * simulator;
+    int tid;
+};
+
 
 #endif
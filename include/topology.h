@@ -0,0 +1,29 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include "config.h"
+#include <vector>
+
+// The static shape of the pipeline: which stages feed which, and how. Stages
+// are numbered from 0 and every edge goes from a lower numbered stage to a 
+// higher numbered one, so iterating over the stages in order always visits a
+// stage after all of its predecessors.
+class Topology {
+  public:
+    Config * config;
+    std::vector< Edge > edges;
+    std::vector< JoinMode > joinModes;
+    std::vector< std::vector< int > > inEdges;
+    std::vector< std::vector< int > > outEdges;
+
+    int numEdgesWithRouting( int stage, Routing routing );
+    std::vector< int > stageDelays();
+    double edgeLoad( int edge, std::vector< double > & load );
+    std::vector< double > expectedLoad();
+    std::vector< int > criticalPath();
+    std::vector< int > bottleneckPath( std::vector< double > & costs );
+
+    Topology( Config * config );
+};
+
+#endif
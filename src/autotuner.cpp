@@ -0,0 +1,250 @@
+#include "autotuner.h"
+#include "config.h"
+#include "simulator.h"
+#include "topology.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+AutoTuner::AutoTuner( Config * config ) {
+    this->config = config;
+}
+
+/*
+ * Changing the number of stages must not change the work done per item, so a
+ * pipeline with fewer stages is made by merging neighbouring stages of the 
+ * configured pipeline, with the merged stage taking as long as its parts put 
+ * together. Out of all the ways to merge the stages, we want the one where the
+ * slowest merged stage is as fast as possible, which is the classic linear 
+ * partition problem, solved here with dynamic programming.
+ *
+ * slowest[ j ][ i ] is the delay of the slowest stage when merging the first i
+ * stages into j stages, and cut[ j ][ i ] is where the last of those j stages 
+ * starts.
+ */
+std::vector< int > AutoTuner::mergedDelays( int numStages ) {
+    Topology topology( config );
+    std::vector< int > delays = topology.stageDelays();
+    int n = delays.size();
+
+    std::vector< long long > prefix( n + 1, 0 );
+    for ( int i = 0; i < n; i++ ) {
+        prefix[ i + 1 ] = prefix[ i ] + delays[ i ];
+    }
+
+    std::vector< std::vector< long long > > slowest( numStages + 1,
+            std::vector< long long >( n + 1, -1 ) );
+    std::vector< std::vector< int > > cut( numStages + 1, 
+            std::vector< int >( n + 1, 0 ) );
+    slowest[ 0 ][ 0 ] = 0;
+
+    for ( int j = 1; j <= numStages; j++ ) {
+        for ( int i = j; i <= n; i++ ) {
+            for ( int p = j - 1; p < i; p++ ) {
+                if ( slowest[ j - 1 ][ p ] == -1 ) {
+                    continue;
+                }
+                long long candidate = std::max( slowest[ j - 1 ][ p ], 
+                        prefix[ i ] - prefix[ p ] );
+                if ( slowest[ j ][ i ] == -1 || candidate < slowest[ j ][ i ] ) {
+                    slowest[ j ][ i ] = candidate;
+                    cut[ j ][ i ] = p;
+                }
+            }
+        }
+    }
+
+    std::vector< int > merged( numStages );
+    for ( int j = numStages, i = n; j > 0; i = cut[ j ][ i ], j-- ) {
+        merged[ j - 1 ] = prefix[ i ] - prefix[ cut[ j ][ i ] ];
+    }
+    return merged;
+}
+
+// The configuration with the given shape. The base delay is set to the delay
+// of the slowest stage so that every imbalance factor is zero or negative.
+Config AutoTuner::candidateConfig( int numStages, int capacity ) {
+    Config candidate = *config;
+    if ( numStages == config->numStages() ) {
+        candidate.reshape( numStages, capacity, config->baseDelay(), 
+                config->imbalanceFactor() );
+        return candidate;
+    }
+
+    std::vector< int > merged = mergedDelays( numStages );
+    int baseDelay = 0;
+    for ( int i = 0; i < numStages; i++ ) {
+        baseDelay = std::max( baseDelay, merged[ i ] );
+    }
+    std::vector< int > imbalanceFactor( numStages );
+    for ( int i = 0; i < numStages; i++ ) {
+        imbalanceFactor[ i ] = merged[ i ] - baseDelay;
+    }
+
+    candidate.reshape( numStages, capacity, baseDelay, imbalanceFactor );
+    return candidate;
+}
+
+// A capacity beyond the number of work items behaves the same as one equal to
+// it, and the capacity can never be below the number of stages.
+int AutoTuner::maxCapacity( int numStages ) {
+    return std::max( numStages, config->numWorkItems() );
+}
+
+double AutoTuner::evaluate( int numStages, int capacity ) {
+    // A single stage pipeline runs without pipelining, where the capacity has
+    // no effect on the timing, so it only ever needs to be run once.
+    if ( numStages == 1 ) {
+        capacity = std::min( config->maxPipelineCapacity(), 
+                config->numWorkItems() );
+    }
+
+    std::pair< int, int > key = std::make_pair( numStages, capacity );
+    if ( evaluated.count( key ) ) {
+        return evaluated[ key ];
+    }
+
+    Config candidate = candidateConfig( numStages, capacity );
+    Simulator simulator( &candidate );
+    if ( bestDuration > 0 ) {
+        simulator.timeBudget = std::chrono::duration< double, std::milli >( 
+                bestDuration * earlyTerminationFactor );
+    }
+    simulator.timePipelinedRun();
+
+    std::cout << "\tnumStages " << numStages << ", maxPipelineCapacity " 
+        << capacity << ": ";
+
+    double throughput = 0;
+    if ( simulator.aborted ) {
+        std::cout << "abandoned after " << simulator.durationPipelined.count() 
+            << " ms" << std::endl;
+    } else {
+        double duration = simulator.durationPipelined.count();
+        throughput = config->numWorkItems() / ( duration / 1000 );
+        std::cout << throughput << " work items per second" << std::endl;
+        if ( bestDuration == 0 || duration < bestDuration ) {
+            bestDuration = duration;
+            best = key;
+        }
+    }
+
+    evaluated[ key ] = throughput;
+    return throughput;
+}
+
+// Try every stage count strictly between low and high, giving each stage the
+// same batch size as in the best candidate found so far.
+void AutoTuner::refineStages( int low, int high ) {
+    int batchSize = std::max( 1, best.second / best.first );
+    for ( int numStages = low + 1; numStages < high; numStages++ ) {
+        if ( evaluated.size() >= maxEvaluations ) {
+            return;
+        }
+        evaluate( numStages, 
+                std::min( numStages * batchSize, maxCapacity( numStages ) ) );
+    }
+}
+
+// Narrow down the capacity for the best stage count by repeatedly trying the
+// midpoints on both sides of the best capacity found so far, shrinking the
+// interval around the best capacity every time.
+void AutoTuner::refineCapacity( int low, int high ) {
+    int numStages = best.first;
+    while ( evaluated.size() < maxEvaluations ) {
+        int capacity = best.second;
+        int left = ( low + capacity ) / 2;
+        int right = ( capacity + high ) / 2;
+        bool tryLeft = left > low && left < capacity;
+        bool tryRight = right > capacity && right < high;
+
+        if ( !tryLeft && !tryRight ) {
+            return;
+        }
+        if ( tryLeft ) {
+            evaluate( numStages, left );
+        }
+        if ( tryRight && evaluated.size() < maxEvaluations ) {
+            evaluate( numStages, right );
+        }
+
+        if ( best.second < capacity ) {
+            high = capacity;
+        } else if ( best.second > capacity ) {
+            low = capacity;
+        } else {
+            low = tryLeft ? left : low;
+            high = tryRight ? right : high;
+        }
+    }
+}
+
+/*
+ * The search first runs the configuration exactly as given, followed by a 
+ * coarse grid of stage counts in powers of two, with batch sizes per stage in
+ * powers of four. Then it tries the stage counts between the grid neighbours 
+ * of the best stage count, and finally narrows down the capacity for the best
+ * stage count. 
+ *
+ * Only the pipelined run of each candidate is timed, and every candidate after
+ * the first one is abandoned once it clearly loses against the best candidate
+ * so far. The number of stages of pipelines with a custom topology is fixed,
+ * as merging stages would change the shape of the pipeline.
+ */
+void AutoTuner::autoTuneMain( std::string outputFileName ) {
+    int numStages = config->numStages();
+    std::vector< int > stageGrid;
+    if ( !config->customTopology() ) {
+        for ( int k = 1; k < numStages; k *= 2 ) {
+            stageGrid.push_back( k );
+        }
+    }
+    stageGrid.push_back( numStages );
+
+    std::cout << "Auto tuning the pipeline configuration" << std::endl;
+
+    evaluate( numStages, config->maxPipelineCapacity() );
+
+    for ( int i = 0; i < stageGrid.size(); i++ ) {
+        int k = stageGrid[ i ];
+        for ( int batchSize = 1; k * batchSize <= maxCapacity( k ); 
+                batchSize *= 4 ) {
+            if ( evaluated.size() >= maxEvaluations ) {
+                break;
+            }
+            evaluate( k, k * batchSize );
+
+            // The capacity makes no difference to a single stage.
+            if ( k == 1 ) {
+                break;
+            }
+        }
+    }
+
+    // Refine the stage count between the grid neighbours of the best one.
+    for ( int i = 0; i < stageGrid.size(); i++ ) {
+        if ( stageGrid[ i ] == best.first ) {
+            refineStages( i > 0 ? stageGrid[ i - 1 ] : best.first, 
+                    i + 1 < stageGrid.size() ? stageGrid[ i + 1 ] 
+                    : best.first );
+            break;
+        }
+    }
+
+    if ( best.first > 1 ) {
+        refineCapacity( std::max( best.first - 1, best.second / 4 ), 
+                std::min( maxCapacity( best.first ) + 1, best.second * 4 ) );
+    }
+
+    Config tuned = candidateConfig( best.first, best.second );
+    tuned.writeConfigFile( outputFileName );
+
+    std::cout << "Best configuration out of " << evaluated.size() 
+        << " candidates: numStages " << tuned.numStages() 
+        << ", maxPipelineCapacity " << tuned.maxPipelineCapacity() << " at " 
+        << evaluated[ best ] << " work items per second" << std::endl;
+    std::cout << "Wrote the configuration to " << outputFileName << std::endl;
+}
@@ -1,4 +1,6 @@
 #include "config.h"
+#include "topology.h"
+#include <cmath>
 #include <sstream>
 #include <fstream>
 #include <stdlib.h>
@@ -37,6 +39,38 @@ bool Config::skipNoPipeline() {
     return this->skipNoPipeline_;
 }
 
+bool Config::virtualTime() {
+    return this->virtualTime_;
+}
+
+void Config::useVirtualTime() {
+    this->virtualTime_ = true;
+}
+
+bool Config::busyWait() {
+    return this->busyWait_;
+}
+
+void Config::useBusyWait() {
+    this->busyWait_ = true;
+}
+
+int Config::metricsInterval() {
+    return this->metricsInterval_;
+}
+
+std::vector< Edge > Config::edges() {
+    return this->edges_;
+}
+
+std::vector< JoinMode > Config::joinModes() {
+    return this->joinModes_;
+}
+
+bool Config::customTopology() {
+    return visitedBitMap & 0b100000;
+}
+
 void Config::parseConfigFile() {
     std::ifstream infile( this->configFileName_ );
 
@@ -58,6 +92,79 @@ void Config::parseConfigFile() {
     verifySemantics();
 }
 
+// Change the shape of an already verified pipeline. Used to try out 
+// different configurations without going through a config file.
+void Config::reshape( int numStages, int maxPipelineCapacity, int baseDelay,
+        std::vector< int > imbalanceFactor ) {
+    this->numStages_ = numStages;
+    this->maxPipelineCapacity_ = maxPipelineCapacity;
+    this->baseDelay_ = baseDelay;
+    this->imbalanceFactor_ = imbalanceFactor;
+
+    // A custom topology keeps its edges, so its stage count cannot change.
+    if ( customTopology() ) {
+        return;
+    }
+
+    this->edges_ = std::vector< Edge >();
+    for ( int i = 0; i < numStages - 1; i++ ) {
+        this->edges_.push_back( { i, i + 1, Routing::Broadcast } );
+    }
+    this->joinModes_ = std::vector< JoinMode >( numStages, JoinMode::Merge );
+}
+
+// Write out the configuration in a form that parseConfigFile accepts.
+void Config::writeConfigFile( std::string fileName ) {
+    std::ofstream outfile( fileName );
+
+    if ( !outfile.is_open() ) {
+        std::cout << "File " << rbus << fileName << rbue 
+            << " could not be opened for writing." << std::endl;
+        exit( 1 );
+    }
+
+    outfile << "numStages " << numStages() << std::endl;
+    outfile << "numWorkItems " << numWorkItems() << std::endl;
+    outfile << "baseDelay " << baseDelay() << std::endl;
+    outfile << "maxPipelineCapacity " << maxPipelineCapacity() << std::endl;
+    outfile << "imbalanceFactor";
+    for ( int i = 0; i < imbalanceFactor().size(); i++ ) {
+        outfile << " " << imbalanceFactor()[ i ];
+    }
+    outfile << std::endl;
+
+    if ( customTopology() ) {
+        for ( int i = 0; i < edges_.size(); i++ ) {
+            outfile << "edge " << edges_[ i ].from + 1 << " " 
+                << edges_[ i ].to + 1 << " " 
+                << ( edges_[ i ].routing == Routing::Broadcast ? "broadcast"
+                    : edges_[ i ].routing == Routing::Split ? "split" 
+                    : "roundRobin" ) << std::endl;
+        }
+        for ( int i = 0; i < joinModes_.size(); i++ ) {
+            if ( joinModes_[ i ] == JoinMode::Sync ) {
+                outfile << "join " << i + 1 << " sync" << std::endl;
+            }
+        }
+    }
+
+    if ( skipNoPipeline() ) {
+        outfile << "skipNoPipeline" << std::endl;
+    }
+
+    if ( virtualTime() ) {
+        outfile << "virtualTime" << std::endl;
+    }
+
+    if ( busyWait() ) {
+        outfile << "busyWait" << std::endl;
+    }
+
+    if ( metricsInterval() ) {
+        outfile << "metricsInterval " << metricsInterval() << std::endl;
+    }
+}
+
 void Config::visit( std::istringstream & iss, int lineNum ) {
     std::string leadingString;
     
@@ -80,6 +187,16 @@ void Config::visit( std::istringstream & iss, int lineNum ) {
         visitImbalanceFactor( iss, lineNum );
     } else if ( leadingString == "skipNoPipeline" ) {
         this->skipNoPipeline_ = true;
+    } else if ( leadingString == "virtualTime" ) {
+        this->virtualTime_ = true;
+    } else if ( leadingString == "busyWait" ) {
+        this->busyWait_ = true;
+    } else if ( leadingString == "metricsInterval" ) {
+        visitMetricsInterval( iss, lineNum );
+    } else if ( leadingString == "edge" ) {
+        visitEdge( iss, lineNum );
+    } else if ( leadingString == "join" ) {
+        visitJoin( iss, lineNum );
     } else { 
         std::cout << rbus << "Error:" << rbue << " Unrecognized configuration "
            << "option: " << rbus << leadingString << rbue << " at line: " 
@@ -197,6 +314,184 @@ void Config::visitImbalanceFactor( std::istringstream & iss, int lineNum ) {
     visitedBitMap |= 0b10000;
 }
 
+void Config::visitMetricsInterval( std::istringstream & iss, int lineNum ) {
+    if ( visitedBitMap & 0b10000000 ) {
+        std::cout << rbus << "Error:" << rbue << " Specifying metricsInterval "
+            << "configuration for the second time." << std::endl;
+        exit( 1 );
+    }
+
+    std::string value;
+    if ( !( iss >> value ) ) {
+        std::cout << rbus << "Error:" << rbue << " Nothing following the "
+            << "metricsInterval configuration keyword" << std::endl;
+        exit( 1 );
+    }
+
+    this->metricsInterval_ = toInt( value, 1 );
+    visitedBitMap |= 0b10000000;
+}
+
+// Unlike the other configuration options, edges and joins can be specified as
+// many times as needed, one per line, so there is no double visit check here.
+void Config::visitEdge( std::istringstream & iss, int lineNum ) {
+    std::string from, to;
+    if ( !( iss >> from >> to ) ) {
+        std::cout << rbus << "Error:" << rbue << " The edge configuration at "
+            << "line " << lineNum << " needs a source and a destination stage"
+            << std::endl;
+        exit( 1 );
+    }
+
+    Edge edge = { toInt( from, 1 ), toInt( to, 2 ), Routing::Broadcast };
+
+    // The routing is optional, a lone edge behaves the same way no matter 
+    // which routing it uses, so broadcast is the default.
+    std::string routing;
+    if ( iss >> routing ) {
+        if ( routing == "broadcast" ) {
+            edge.routing = Routing::Broadcast;
+        } else if ( routing == "split" ) {
+            edge.routing = Routing::Split;
+        } else if ( routing == "roundRobin" ) {
+            edge.routing = Routing::RoundRobin;
+        } else {
+            std::cout << rbus << "Error:" << rbue << " Unrecognized edge "
+                << "routing " << rbus << routing << rbue << " at line: " 
+                << lineNum << ". Expected one of broadcast, split or "
+                << "roundRobin." << std::endl;
+            exit( 1 );
+        }
+    }
+
+    this->edges_.push_back( edge );
+    visitedBitMap |= 0b100000;
+}
+
+void Config::visitJoin( std::istringstream & iss, int lineNum ) {
+    std::string stage, mode;
+    if ( !( iss >> stage >> mode ) ) {
+        std::cout << rbus << "Error:" << rbue << " The join configuration at "
+            << "line " << lineNum << " needs a stage and a join mode" 
+            << std::endl;
+        exit( 1 );
+    }
+
+    JoinMode joinMode;
+    if ( mode == "merge" ) {
+        joinMode = JoinMode::Merge;
+    } else if ( mode == "sync" ) {
+        joinMode = JoinMode::Sync;
+    } else {
+        std::cout << rbus << "Error:" << rbue << " Unrecognized join mode " 
+            << rbus << mode << rbue << " at line: " << lineNum 
+            << ". Expected either merge or sync." << std::endl;
+        exit( 1 );
+    }
+
+    this->joinSpecs_.push_back( std::make_pair( toInt( stage, 1 ), joinMode ) );
+    visitedBitMap |= 0b1000000;
+}
+
+// Stages are numbered from 1 in the config file, same as in the error 
+// messages, but are stored numbered from 0 like everywhere in the simulator.
+void Config::verifyTopology() {
+    // Without any edges the pipeline is the usual linear chain of stages.
+    if ( !( visitedBitMap & 0b100000 ) ) {
+        for ( int i = 0; i < numStages() - 1; i++ ) {
+            this->edges_.push_back( { i, i + 1, Routing::Broadcast } );
+        }
+    } else {
+        for ( int i = 0; i < edges_.size(); i++ ) {
+            Edge & edge = edges_[ i ];
+            if ( edge.from < 1 || edge.from > numStages() || edge.to < 1 
+                    || edge.to > numStages() ) {
+                std::cout << rbus << "Error:" << rbue << " The edge from stage "
+                    << edge.from << " to stage " << edge.to << " refers to a "
+                    << "stage that does not exist." << std::endl;
+                exit( 1 );
+            }
+
+            // Only allowing edges to go forward guarantees that there are no
+            // cycles, and that the stage order is a topological order.
+            if ( edge.from >= edge.to ) {
+                std::cout << rbus << "Error:" << rbue << " The edge from stage "
+                    << edge.from << " to stage " << edge.to << " does not go "
+                    << "forward. Edges must go from a lower numbered stage to "
+                    << "a higher numbered stage." << std::endl;
+                exit( 1 );
+            }
+
+            for ( int j = 0; j < i; j++ ) {
+                if ( edges_[ j ].from == edge.from - 1 
+                        && edges_[ j ].to == edge.to - 1 ) {
+                    std::cout << rbus << "Error:" << rbue << " The edge from "
+                        << "stage " << edge.from << " to stage " << edge.to 
+                        << " is specified more than once." << std::endl;
+                    exit( 1 );
+                }
+            }
+
+            edge.from--;
+            edge.to--;
+        }
+    }
+
+    // The first stage is the only one fed from the work queue, so every other
+    // stage must be reachable through some edge.
+    std::vector< int > inDegree( numStages(), 0 );
+    for ( int i = 0; i < edges_.size(); i++ ) {
+        inDegree[ edges_[ i ].to ]++;
+    }
+    for ( int i = 1; i < numStages(); i++ ) {
+        if ( inDegree[ i ] == 0 ) {
+            std::cout << rbus << "Error:" << rbue << " Stage " << i + 1 
+                << " has no incoming edges. Every stage but the first must "
+                << "have at least one incoming edge." << std::endl;
+            exit( 1 );
+        }
+    }
+
+    this->joinModes_ = std::vector< JoinMode >( numStages(), JoinMode::Merge );
+    for ( int i = 0; i < joinSpecs_.size(); i++ ) {
+        int stage = joinSpecs_[ i ].first;
+        if ( stage < 1 || stage > numStages() ) {
+            std::cout << rbus << "Error:" << rbue << " The join mode is "
+                << "specified for stage " << stage << ", which does not "
+                << "exist." << std::endl;
+            exit( 1 );
+        }
+        this->joinModes_[ stage - 1 ] = joinSpecs_[ i ].second;
+    }
+
+    // A sync join pairs items up across its incoming edges, so if one edge 
+    // carries items faster than another, the backlog on the faster edge grows
+    // without bound and ends up processed as one huge batch at the very end.
+    Topology topology( this );
+    std::vector< double > load = topology.expectedLoad();
+    for ( int stage = 0; stage < numStages(); stage++ ) {
+        if ( joinModes_[ stage ] != JoinMode::Sync ) {
+            continue;
+        }
+        std::vector< int > & inEdges = topology.inEdges[ stage ];
+        for ( int i = 1; i < inEdges.size(); i++ ) {
+            double first = topology.edgeLoad( inEdges[ 0 ], load );
+            double other = topology.edgeLoad( inEdges[ i ], load );
+            if ( std::fabs( first - other ) > 1e-9 ) {
+                std::cout << rbus << "Error:" << rbue << " The sync join at "
+                    << "stage " << stage + 1 << " gets " << first << " items "
+                    << "per work item from stage " 
+                    << topology.edges[ inEdges[ 0 ] ].from + 1 << " but " 
+                    << other << " from stage " 
+                    << topology.edges[ inEdges[ i ] ].from + 1 << ". Every "
+                    << "incoming edge of a sync join must carry items at the "
+                    << "same rate." << std::endl;
+                exit( 1 );
+            }
+        }
+    }
+}
+
 void Config::verifySemantics() {
     // Make sure there are more than 0 stages.
     if ( numStages() < 1 ) {
@@ -235,6 +530,13 @@ void Config::verifySemantics() {
         }
     } 
 
+    if ( metricsInterval() < 0 ) {
+        std::cout << rbus << "Error:" << rbue << " The metrics interval is "
+            << "negative. Please, provide a positive interval in milli seconds,"
+            << " or 0 to turn off live metrics." << std::endl;
+        exit( 1 );
+    }
+
     if ( numWorkItems() < 1 ) {
         std::cout << rbus << "Error:" << rbue << " Fewer than 1 work item is "
             << "provided. Please, provide 1 or more work items." << std::endl;
@@ -251,4 +553,6 @@ void Config::verifySemantics() {
             << "increase the maxPipelineCapacity." << std::endl;
         exit( 1 );
     }
+
+    verifyTopology();
 }
@@ -0,0 +1,156 @@
+#include "coscheduler.h"
+#include "config.h"
+#include "simulator.h"
+#include <chrono>
+#include <iostream>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Red Bold Underlined ANSII escape sequence start and end
+static std::string const rbus = "\033[31;1;4m";
+static std::string const rbue = "\033[0m"; 
+
+struct CoScheduledArgs {
+    Simulator * simulator;
+    pthread_barrier_t * startBarrier;
+};
+
+CoScheduler::CoScheduler( std::vector< char * > configFileNames ) {
+    // The simulators keep pointers to their configs, so neither vector can be
+    // allowed to reallocate once the simulators are created.
+    configs.reserve( configFileNames.size() );
+    simulators.reserve( configFileNames.size() );
+
+    for ( int i = 0; i < configFileNames.size(); i++ ) {
+        this->configFileNames.push_back( std::string( configFileNames[ i ] ) );
+        configs.push_back( Config( configFileNames[ i ] ) );
+        configs[ i ].parseConfigFile();
+
+        // Virtual time never touches the cores, so there is nothing for the 
+        // pipelines to contend for.
+        if ( configs[ i ].virtualTime() ) {
+            std::cout << rbus << "Error:" << rbue << " Configuration file " 
+                << configFileNames[ i ] << " runs in virtual time, which "
+                << "cannot be co-scheduled. Please remove the virtualTime "
+                << "keyword." << std::endl;
+            exit( 1 );
+        }
+
+        // Sleeping stages hold no core, so they would never contend with each
+        // other. Busy waiting makes every stage thread compete for a core.
+        configs[ i ].useBusyWait();
+    }
+    for ( int i = 0; i < configs.size(); i++ ) {
+        simulators.push_back( Simulator( &configs[ i ] ) );
+    }
+}
+
+int CoScheduler::totalStageThreads() {
+    int total = 0;
+    for ( int i = 0; i < configs.size(); i++ ) {
+        total += configs[ i ].numStages();
+    }
+    return total;
+}
+
+static double throughput( Config & config, double duration ) {
+    return config.numWorkItems() / ( duration / 1000 );
+}
+
+// The baseline for every pipeline is its pipelined run with the machine all 
+// to itself.
+void CoScheduler::runAlone() {
+    durationsAlone = std::vector< double >( simulators.size() );
+    for ( int i = 0; i < simulators.size(); i++ ) {
+        std::cout << "Starting pipeline " << i + 1 << " alone" << std::endl;
+        simulators[ i ].timePipelinedRun();
+        durationsAlone[ i ] = simulators[ i ].durationPipelined.count();
+        std::cout << "\tThroughput: " 
+            << throughput( configs[ i ], durationsAlone[ i ] ) 
+            << " work items per second" << std::endl;
+    }
+}
+
+static void * coScheduledPipelineMain( void * arg ) {
+    CoScheduledArgs * args = ( CoScheduledArgs * ) arg;
+
+    // Wait for every pipeline to be ready, so that they all start together.
+    pthread_barrier_wait( args->startBarrier );
+    args->simulator->timePipelinedRun();
+
+    // This return is to get rid of a compiler warning.
+    return 0;
+}
+
+/*
+ * Every pipeline gets its own control thread, which then starts the stage 
+ * threads of that pipeline. The main thread joins the start barrier as well,
+ * so the time it measures covers everything from the moment all the pipelines
+ * are released until the last one of them finishes.
+ */
+void CoScheduler::runTogether() {
+    TID = std::vector< pthread_t >( simulators.size() );
+    std::vector< CoScheduledArgs > args( simulators.size() );
+    pthread_barrier_init( &startBarrier, NULL, simulators.size() + 1 );
+
+    for ( int i = 0; i < simulators.size(); i++ ) {
+        args[ i ] = { &simulators[ i ], &startBarrier };
+        pthread_create( &TID[ i ], NULL, coScheduledPipelineMain, &args[ i ] );
+    }
+
+    std::cout << "Starting " << simulators.size() << " pipelines together" 
+        << std::endl;
+
+    pthread_barrier_wait( &startBarrier );
+    auto startTimer = std::chrono::high_resolution_clock::now();
+    for ( int i = 0; i < simulators.size(); i++ ) {
+        pthread_join( TID[ i ], NULL );
+    }
+    auto endTimer = std::chrono::high_resolution_clock::now();
+    std::chrono::duration< double, std::milli > makespan = endTimer - startTimer;
+
+    pthread_barrier_destroy( &startBarrier );
+
+    report( makespan.count() );
+}
+
+void CoScheduler::report( double makespan ) {
+    int totalWorkItems = 0;
+    double totalDurationAlone = 0;
+
+    for ( int i = 0; i < simulators.size(); i++ ) {
+        double durationTogether = simulators[ i ].durationPipelined.count();
+        std::cout << "\tPipeline " << i + 1 << " (" << configFileNames[ i ]
+            << ", " << configs[ i ].numStages() << " stages): " 
+            << throughput( configs[ i ], durationTogether ) 
+            << " work items per second, a slowdown of " 
+            << durationTogether / durationsAlone[ i ] 
+            << " relative to running alone" << std::endl;
+        totalWorkItems += configs[ i ].numWorkItems();
+        totalDurationAlone += durationsAlone[ i ];
+    }
+
+    std::cout << "\tAggregate throughput: " 
+        << totalWorkItems / ( makespan / 1000 ) << " work items per second, "
+        << "compared to " << totalWorkItems / ( totalDurationAlone / 1000 )
+        << " when running the pipelines one after another" << std::endl;
+
+    long cores = sysconf( _SC_NPROCESSORS_ONLN );
+    std::cout << "\t" << totalStageThreads() << " stage threads shared " 
+        << cores << " cores";
+    if ( totalStageThreads() > cores ) {
+        std::cout << ", oversubscribed by a factor of " 
+            << ( double ) totalStageThreads() / cores;
+    }
+    std::cout << std::endl;
+}
+
+void CoScheduler::coScheduleMain() {
+    std::cout << "Stages busy wait instead of sleeping, so that every stage "
+        << "thread competes for a core" << std::endl;
+    runAlone();
+    runTogether();
+}
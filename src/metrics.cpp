@@ -0,0 +1,167 @@
+#include "metrics.h"
+#include <fcntl.h>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <stdlib.h>
+#include <pthread.h>
+#include <string>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+// Red Bold Underlined ANSII escape sequence start and end
+static std::string const rbus = "\033[31;1;4m";
+static std::string const rbue = "\033[0m"; 
+
+long long nanosSince( struct timespec & start ) {
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return ( now.tv_sec - start.tv_sec ) * 1000000000LL 
+        + ( now.tv_nsec - start.tv_nsec );
+}
+
+/*
+ * The counters live in a POSIX shared memory object named after the process, 
+ * so they show up as /dev/shm/pipe-sim-<pid> on Linux. If the shared memory 
+ * object cannot be created, the counters fall back to private memory, which
+ * still lets the stats thread print them.
+ */
+Metrics::Metrics( int numStages, int intervalMs ) {
+    this->numStages = numStages;
+    this->intervalMs = intervalMs;
+    this->shmName = "/pipe-sim-" + std::to_string( getpid() );
+    this->size = sizeof( MetricsHeader ) + numStages * sizeof( StageMetrics );
+
+    void * block = MAP_FAILED;
+    int fd = shm_open( shmName.c_str(), O_CREAT | O_RDWR, 0644 );
+    if ( fd != -1 && ftruncate( fd, size ) == 0 ) {
+        block = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+        shared = block != MAP_FAILED;
+    }
+    if ( fd != -1 ) {
+        close( fd );
+    }
+
+    if ( !shared ) {
+        shm_unlink( shmName.c_str() );
+        std::cout << "Could not create the shared memory object " << shmName
+            << ", the live metrics will only be printed." << std::endl;
+        block = mmap( NULL, size, PROT_READ | PROT_WRITE, 
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+        if ( block == MAP_FAILED ) {
+            std::cout << rbus << "Error:" << rbue << " Could not allocate "
+                << "memory for the live metrics." << std::endl;
+            exit( 1 );
+        }
+    }
+
+    // mmap hands out page aligned memory, so both structs end up cache line
+    // aligned as well.
+    header = new ( block ) MetricsHeader();
+    header->numStages = numStages;
+    stages = ( StageMetrics * ) ( ( char * ) block + sizeof( MetricsHeader ) );
+    for ( int i = 0; i < numStages; i++ ) {
+        new ( &stages[ i ] ) StageMetrics();
+    }
+
+    pthread_mutex_init( &mutex, NULL );
+    pthread_cond_init( &stopCondition, NULL );
+    clock_gettime( CLOCK_MONOTONIC, &startTime );
+}
+
+Metrics::~Metrics() {
+    stop();
+    pthread_cond_destroy( &stopCondition );
+    pthread_mutex_destroy( &mutex );
+    munmap( header, size );
+    if ( shared ) {
+        shm_unlink( shmName.c_str() );
+    }
+}
+
+void Metrics::beginPhase( int phase ) {
+    for ( int i = 0; i < numStages; i++ ) {
+        stages[ i ].itemsProcessed.store( 0, std::memory_order_relaxed );
+        stages[ i ].currentBatch.store( 0, std::memory_order_relaxed );
+        stages[ i ].barrierWaitNanos.store( 0, std::memory_order_relaxed );
+    }
+    header->phase.store( phase, std::memory_order_release );
+}
+
+// Stamp the block with a new snapshot and print it. The counters are read 
+// one at a time, so a snapshot is not an atomic view of every stage, which is
+// fine for watching progress.
+//
+// The snapshot goes to stderr, so that it stays out of the results printed to
+// stdout when those are redirected. It is written with a single call, so a 
+// snapshot never gets split up, but on a terminal it can still end up in the 
+// middle of a line printed by the simulation itself.
+void Metrics::publish() {
+    long long elapsed = nanosSince( startTime );
+    header->elapsedNanos.store( elapsed, std::memory_order_relaxed );
+    header->snapshots.fetch_add( 1, std::memory_order_release );
+
+    std::ostringstream snapshot;
+    snapshot << "\t[" << elapsed / 1e9 << " s, " 
+        << ( header->phase.load( std::memory_order_relaxed ) ? "" : "non " ) 
+        << "pipelined]";
+    for ( int i = 0; i < numStages; i++ ) {
+        snapshot << " stage " << i + 1 << ": " 
+            << stages[ i ].itemsProcessed.load( std::memory_order_relaxed ) 
+            << " items, batch " 
+            << stages[ i ].currentBatch.load( std::memory_order_relaxed )
+            << ", " << stages[ i ].barrierWaitNanos.load( 
+                    std::memory_order_relaxed ) / 1e6 
+            << " ms at barriers" << ( i + 1 < numStages ? ";" : "" );
+    }
+    snapshot << "\n";
+    std::cerr << snapshot.str() << std::flush;
+}
+
+static void * statsThreadMain( void * arg ) {
+    ( ( Metrics * ) arg )->statsLoop();
+
+    // This return is to get rid of a compiler warning.
+    return 0;
+}
+
+// Publish a snapshot every intervalMs until stop is called. Waiting on a 
+// condition variable instead of sleeping lets stop return right away.
+void Metrics::statsLoop() {
+    pthread_mutex_lock( &mutex );
+    while ( running ) {
+        struct timespec wakeUp;
+        clock_gettime( CLOCK_REALTIME, &wakeUp );
+        long long nanos = wakeUp.tv_nsec + intervalMs * 1000000LL;
+        wakeUp.tv_sec += nanos / 1000000000LL;
+        wakeUp.tv_nsec = nanos % 1000000000LL;
+
+        pthread_cond_timedwait( &stopCondition, &mutex, &wakeUp );
+        if ( running ) {
+            publish();
+        }
+    }
+    pthread_mutex_unlock( &mutex );
+}
+
+void Metrics::start() {
+    if ( shared ) {
+        std::cout << "Publishing live metrics to /dev/shm" << shmName 
+            << " every " << intervalMs << " ms" << std::endl;
+    }
+    running = true;
+    pthread_create( &statsThread, NULL, statsThreadMain, this );
+}
+
+void Metrics::stop() {
+    pthread_mutex_lock( &mutex );
+    if ( !running ) {
+        pthread_mutex_unlock( &mutex );
+        return;
+    }
+    running = false;
+    pthread_cond_signal( &stopCondition );
+    pthread_mutex_unlock( &mutex );
+    pthread_join( statsThread, NULL );
+}
@@ -0,0 +1,177 @@
+#include "perftest.h"
+#include "config.h"
+#include "simulator.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// Red Bold Underlined ANSII escape sequence start and end
+static std::string const rbus = "\033[31;1;4m";
+static std::string const rbue = "\033[0m"; 
+
+PerfTest::PerfTest( std::string baselineFileName ) {
+    this->baselineFileName = baselineFileName;
+}
+
+/*
+ * Every line of the baseline file that is not empty or a comment holds:
+ *     <config file> <throughput> <speedup> <control iterations> <tolerance>
+ * where the tolerance is in percent and applies to all three numbers.
+ */
+void PerfTest::parseBaselineFile() {
+    std::ifstream infile( baselineFileName );
+
+    if ( !infile.is_open() ) {
+        std::cout << "File " << rbus << baselineFileName << rbue 
+            << " could not be opened. Please check that this file exists." 
+            << std::endl;
+        exit( 1 );
+    }
+
+    std::string line;
+    int lineNum = 0;
+    while ( std::getline( infile, line ) ) {
+        std::istringstream iss( line );
+        std::string leadingString;
+        if ( !( iss >> leadingString ) || leadingString[ 0 ] == '#' ) {
+            lineNum++;
+            continue;
+        }
+
+        PerfResult result;
+        result.configFileName = leadingString;
+        if ( !( iss >> result.baselineThroughput >> result.baselineSpeedup
+                    >> result.baselineControlIterations >> result.tolerance ) ) {
+            std::cout << rbus << "Error:" << rbue << " Malformed baseline at "
+                << "line: " << lineNum << ". Expected a configuration file "
+                << "followed by the throughput, speedup, control iterations "
+                << "and tolerance." << std::endl;
+            exit( 1 );
+        }
+        results.push_back( result );
+        lineNum++;
+    }
+}
+
+/*
+ * The configuration always runs in virtual time, so the numbers only change 
+ * when the behaviour of the simulator changes. Controller overhead is tracked
+ * as the number of iterations the controller had to run, since that is what
+ * the barriers and the control work scale with.
+ */
+void PerfTest::runConfig( PerfResult & result ) {
+    Config config( &result.configFileName[ 0 ] );
+    config.parseConfigFile();
+    config.useVirtualTime();
+
+    Simulator simulator( &config );
+    simulator.setUpTimeSpecs();
+    simulator.durationNonPipelined = simulator.timeNoPipelinerSimulation();
+    simulator.timePipelinedRun();
+
+    result.throughput = config.numWorkItems() 
+        / ( simulator.durationPipelined.count() / 1000 );
+    result.speedup = simulator.durationNonPipelined.count() 
+        / simulator.durationPipelined.count();
+    result.controlIterations = simulator.controlIterations;
+    result.itemsProcessed = simulator.stageItemsProcessed[ 0 ];
+    result.numWorkItems = config.numWorkItems();
+
+    double slack = result.tolerance / 100;
+    std::cout << result.configFileName << ":" << std::endl;
+
+    // The throughput is only meaningful if the pipeline processed exactly the
+    // configured number of work items, so this one has no tolerance.
+    if ( result.itemsProcessed != result.numWorkItems ) {
+        result.passed = false;
+        std::cout << "\t" << rbus << "Regression:" << rbue;
+    } else {
+        std::cout << "\tOK:";
+    }
+    std::cout << " work items processed " << result.itemsProcessed 
+        << " (configured " << result.numWorkItems << ")" << std::endl;
+
+    if ( result.throughput < result.baselineThroughput * ( 1 - slack ) ) {
+        result.passed = false;
+        std::cout << "\t" << rbus << "Regression:" << rbue;
+    } else {
+        std::cout << "\tOK:";
+    }
+    std::cout << " throughput " << result.throughput << " (baseline " 
+        << result.baselineThroughput << ")" << std::endl;
+
+    if ( result.speedup < result.baselineSpeedup * ( 1 - slack ) ) {
+        result.passed = false;
+        std::cout << "\t" << rbus << "Regression:" << rbue;
+    } else {
+        std::cout << "\tOK:";
+    }
+    std::cout << " speedup " << result.speedup << " (baseline " 
+        << result.baselineSpeedup << ")" << std::endl;
+
+    if ( result.controlIterations 
+            > result.baselineControlIterations * ( 1 + slack ) ) {
+        result.passed = false;
+        std::cout << "\t" << rbus << "Regression:" << rbue;
+    } else {
+        std::cout << "\tOK:";
+    }
+    std::cout << " control iterations " << result.controlIterations 
+        << " (baseline " << result.baselineControlIterations << ")" 
+        << std::endl;
+}
+
+void PerfTest::writeResultsFile( std::string fileName, std::string revision ) {
+    std::ofstream outfile( fileName );
+
+    if ( !outfile.is_open() ) {
+        std::cout << "File " << rbus << fileName << rbue 
+            << " could not be opened for writing." << std::endl;
+        exit( 1 );
+    }
+
+    bool passed = true;
+    outfile << "{" << std::endl;
+    outfile << "  \"revision\": \"" << revision << "\"," << std::endl;
+    outfile << "  \"results\": [" << std::endl;
+    for ( int i = 0; i < results.size(); i++ ) {
+        PerfResult & result = results[ i ];
+        passed = passed && result.passed;
+        outfile << "    { \"config\": \"" << result.configFileName << "\", "
+            << "\"throughput\": " << result.throughput << ", "
+            << "\"baselineThroughput\": " << result.baselineThroughput << ", "
+            << "\"speedup\": " << result.speedup << ", "
+            << "\"baselineSpeedup\": " << result.baselineSpeedup << ", "
+            << "\"controlIterations\": " << result.controlIterations << ", "
+            << "\"baselineControlIterations\": " 
+            << result.baselineControlIterations << ", "
+            << "\"itemsProcessed\": " << result.itemsProcessed << ", "
+            << "\"numWorkItems\": " << result.numWorkItems << ", "
+            << "\"tolerance\": " << result.tolerance << ", "
+            << "\"passed\": " << ( result.passed ? "true" : "false" ) << " }"
+            << ( i + 1 < results.size() ? "," : "" ) << std::endl;
+    }
+    outfile << "  ]," << std::endl;
+    outfile << "  \"passed\": " << ( passed ? "true" : "false" ) << std::endl;
+    outfile << "}" << std::endl;
+}
+
+int PerfTest::perfTestMain( std::string resultsFileName, std::string revision ) {
+    parseBaselineFile();
+
+    int failures = 0;
+    for ( int i = 0; i < results.size(); i++ ) {
+        runConfig( results[ i ] );
+        failures += results[ i ].passed ? 0 : 1;
+    }
+
+    writeResultsFile( resultsFileName, revision );
+
+    std::cout << results.size() - failures << " out of " << results.size() 
+        << " configurations matched their baselines. Results were written to "
+        << resultsFileName << std::endl;
+    return failures ? 1 : 0;
+}
@@ -5,6 +5,10 @@
 #include "config.h"
 #include <cstdlib>
 #include "simulator.h"
+#include "autotuner.h"
+#include "coscheduler.h"
+#include "perftest.h"
+#include <string>
 
 void dumpConfiguration( Config & config ) {
     std::cout << "numStages: " << config.numStages() << std::endl;
@@ -18,22 +22,78 @@ void dumpConfiguration( Config & config ) {
         << std::endl;
     std::cout << "baseDelay: " << config.baseDelay() << std::endl;
     std::cout << "skipNoPipeline: " << config.skipNoPipeline() << std::endl;
+    std::cout << "virtualTime: " << config.virtualTime() << std::endl;
+    std::cout << "busyWait: " << config.busyWait() << std::endl;
+    std::cout << "metricsInterval: " << config.metricsInterval() << std::endl;
+    std::cout << "edges: [";
+    for ( int i = 0; i < config.edges().size(); i++ ) {
+        Edge edge = config.edges()[ i ];
+        std::cout << " " << edge.from + 1 << "->" << edge.to + 1;
+    }
+    std::cout << " ]" << std::endl;
+}
+
+static void printUsage() {
+    std::cout << "Command usage:\n\tbin/pipe-sim [optional/path/to/"
+        << "configuration/file]\n\tbin/pipe-sim --auto-tune path/to/"
+        << "configuration/file path/to/output/file\n\tbin/pipe-sim "
+        << "--co-schedule path/to/configuration/file [more/configuration/"
+        << "files ...]\n\tbin/pipe-sim --perf-test path/to/baseline/file "
+        << "path/to/results/file [revision]" << std::endl;
 }
 
 int main( int argc, char** argv ) {
-    if ( argc > 2 ) {
+    if ( argc > 1 && std::string( argv[ 1 ] ) == "--co-schedule" ) {
+        if ( argc < 3 ) {
+            std::cout << "Co-scheduling needs at least one configuration "
+                << "file.\n";
+            printUsage();
+            return 1;
+        }
+        CoScheduler coScheduler( std::vector< char * >( argv + 2, 
+                    argv + argc ) );
+        coScheduler.coScheduleMain();
+        return 0;
+    }
+
+    if ( argc > 1 && std::string( argv[ 1 ] ) == "--perf-test" ) {
+        if ( argc != 4 && argc != 5 ) {
+            std::cout << "Performance testing needs a baseline file and a "
+                << "results file.\n";
+            printUsage();
+            return 1;
+        }
+        PerfTest perfTest( argv[ 2 ] );
+        return perfTest.perfTestMain( argv[ 3 ], ( argc == 5 ) ? argv[ 4 ] 
+                : "" );
+    }
+
+    bool autoTune = argc > 1 && std::string( argv[ 1 ] ) == "--auto-tune";
+    if ( autoTune && argc != 4 ) {
+        std::cout << "Auto tuning needs exactly one configuration file and one"
+            << " output file.\n";
+        printUsage();
+        return 1;
+    }
+    if ( !autoTune && argc > 2 ) {
         std::cout << "More than one argument provided, only one or less " 
-            << "supported.\nCommand usage:\n\tbin/pipe-sim [optional/path/to"
-            << "/configuration/file]" << std::endl;
+            << "supported.\n";
+        printUsage();
         return 1;
     }
     char defaultFile[] = "/dev/null";
-    Config config( ( argc < 2 ) ? defaultFile : argv[ 1 ] );
+    Config config( autoTune ? argv[ 2 ] 
+            : ( argc < 2 ) ? defaultFile : argv[ 1 ] );
     config.parseConfigFile();
     bool debug = std::getenv( "DEBUG" );
     if ( debug ) {
         dumpConfiguration( config );
     }
+    if ( autoTune ) {
+        AutoTuner autoTuner( &config );
+        autoTuner.autoTuneMain( argv[ 3 ] );
+        return 0;
+    }
     Simulator simulator( &config );
     simulator.debug = debug;
     simulator.simulatorMain();
@@ -1,17 +1,16 @@
 #include "simulator.h"
 #include "config.h"
+#include "topology.h"
+#include "metrics.h"
 #include <pthread.h>
 #include <time.h>
 #include <queue>
+#include <algorithm>
 #include <iostream>
 #include <vector>
 
 static void * pipelinerSimulatorMain( void * arg );
 
-// This is a crazy hack as I am too lazy to figure out how to pass this pointer
-// correctly into the threads, so in shmem it sits. Hope I fix this before I 
-// "release" this.
-Simulator * shmemSimulatorHandle = nullptr;
 
 void Simulator::resetControlSignals() {
     controlSignals = std::vector< int >();
@@ -30,10 +29,182 @@ void Simulator::setUpTimeSpecs() {
     }
 }
 
-Simulator::Simulator( Config * config ) {
+Simulator::Simulator( Config * config ) : topology( config ) {
     this->config = config;
 }
 
+void Simulator::resetRouting() {
+    edgePending = std::vector< int >( topology.edges.size(), 0 );
+    roundRobinCursors = std::vector< int >( config->numStages(), 0 );
+    splitCursors = std::vector< int >( config->numStages(), 0 );
+}
+
+void Simulator::resetVirtualTime() {
+    virtualClock = 0;
+    stageVirtualTime = std::vector< long long >( 
+            config->numStages() * falseSharingPreventionBuffer, 0 );
+}
+
+std::chrono::duration< double, std::milli > Simulator::virtualDuration() {
+    return std::chrono::duration< double, std::milli >( virtualClock / 1e6 );
+}
+
+// A sleeping thread does not hold on to a core, so to have the stages compete
+// for cores the way real work does, spin on the clock until the delay is over.
+static void spinFor( struct timespec const & delay ) {
+    struct timespec start, now;
+    clock_gettime( CLOCK_MONOTONIC, &start );
+    long long target = delay.tv_sec * 1000000000LL + delay.tv_nsec;
+    do {
+        clock_gettime( CLOCK_MONOTONIC, &now );
+    } while ( ( now.tv_sec - start.tv_sec ) * 1000000000LL 
+            + ( now.tv_nsec - start.tv_nsec ) < target );
+}
+
+void Simulator::processWorkItems( int stage, int items ) {
+    if ( metrics ) {
+        metrics->startBatch( stage, items );
+    }
+
+    // In virtual time, only keep track of how long the stage would have slept
+    // for. This makes the timings fully deterministic.
+    if ( config->virtualTime() ) {
+        stageVirtualTime[ stage * falseSharingPreventionBuffer ] += 
+            ( long long ) items * timespecs[ stage ].tv_nsec;
+        if ( metrics ) {
+            metrics->finishBatch( stage, items );
+        }
+        return;
+    }
+
+    for ( int workItem = 0; workItem < items; workItem++ ) {
+        // "Process" the work item.
+        // In the case of the simulator, you "process" by sleeping for a 
+        // specified amount of time, or by spinning for it when the stages 
+        // should keep their cores busy.
+        if ( config->busyWait() ) {
+            spinFor( timespecs[ stage ] );
+        } else {
+            nanosleep( &( timespecs[ stage ] ), NULL );
+        }
+        if ( metrics ) {
+            metrics->finishBatch( stage, 1 );
+        }
+
+        // Large batches can take a while, so a run with a deadline checks it
+        // after every work item instead of only between batches. Only the 
+        // control thread marks the run as aborted, as every stage thread 
+        // passes through here.
+        if ( hasDeadline() 
+                && std::chrono::high_resolution_clock::now() >= deadline ) {
+            return;
+        }
+    }
+}
+
+/*
+ * Hand the output of a stage over to the edges leaving it. All the broadcast 
+ * edges get the full batch. The split edges share the batch, and when the 
+ * batch does not divide evenly, the leftover items go one each to the split 
+ * edges starting from a cursor that moves on with every leftover item. This
+ * way every split edge carries the same share of the items in the long run.
+ * Only one of the round robin edges gets the batch, and the next batch goes
+ * to the next round robin edge.
+ */
+void Simulator::routeStageOutput( int stage, int items ) {
+    if ( items == 0 ) {
+        return;
+    }
+
+    int numSplit = topology.numEdgesWithRouting( stage, Routing::Split );
+    int numRoundRobin = 
+        topology.numEdgesWithRouting( stage, Routing::RoundRobin );
+    int splitIndex = 0;
+    int roundRobinIndex = 0;
+
+    for ( int i = 0; i < topology.outEdges[ stage ].size(); i++ ) {
+        int edge = topology.outEdges[ stage ][ i ];
+        switch ( topology.edges[ edge ].routing ) {
+            case Routing::Broadcast:
+                edgePending[ edge ] += items;
+                break;
+            case Routing::Split:
+                edgePending[ edge ] += items / numSplit 
+                    + ( ( splitIndex++ - splitCursors[ stage ] + numSplit ) 
+                            % numSplit < items % numSplit ? 1 : 0 );
+                break;
+            case Routing::RoundRobin:
+                if ( roundRobinIndex++ == roundRobinCursors[ stage ] ) {
+                    edgePending[ edge ] += items;
+                }
+                break;
+        }
+    }
+
+    if ( numSplit ) {
+        splitCursors[ stage ] = 
+            ( splitCursors[ stage ] + items % numSplit ) % numSplit;
+    }
+    if ( numRoundRobin ) {
+        roundRobinCursors[ stage ] = 
+            ( roundRobinCursors[ stage ] + 1 ) % numRoundRobin;
+    }
+}
+
+/*
+ * Collect the input of a stage from the edges coming into it. A merge join 
+ * takes everything that is waiting on any edge. A sync join only fires once 
+ * every edge has items waiting, and takes as many items from each edge as the
+ * emptiest edge has, so the items are paired up across the edges. An edge 
+ * that is empty and whose predecessor is done can never provide another item,
+ * so the sync join stops waiting for it.
+ */
+int Simulator::gatherStageInput( int stage ) {
+    std::vector< int > & inEdges = topology.inEdges[ stage ];
+    int input = 0;
+
+    if ( topology.joinModes[ stage ] == JoinMode::Merge ) {
+        for ( int i = 0; i < inEdges.size(); i++ ) {
+            input += edgePending[ inEdges[ i ] ];
+            edgePending[ inEdges[ i ] ] = 0;
+        }
+        return input;
+    }
+
+    for ( int i = 0; i < inEdges.size(); i++ ) {
+        int pending = edgePending[ inEdges[ i ] ];
+        if ( pending == 0 ) {
+            if ( controlSignals[ topology.edges[ inEdges[ i ] ].from ] == 1 ) {
+                continue;
+            }
+            return 0;
+        }
+        if ( input == 0 || pending < input ) {
+            input = pending;
+        }
+    }
+
+    for ( int i = 0; i < inEdges.size(); i++ ) {
+        if ( edgePending[ inEdges[ i ] ] ) {
+            edgePending[ inEdges[ i ] ] -= input;
+        }
+    }
+    return input;
+}
+
+// A stage can never receive another item once all of its predecessors are 
+// done and all of its incoming edges are empty.
+bool Simulator::upstreamDone( int stage ) {
+    std::vector< int > & inEdges = topology.inEdges[ stage ];
+    for ( int i = 0; i < inEdges.size(); i++ ) {
+        if ( edgePending[ inEdges[ i ] ] 
+                || controlSignals[ topology.edges[ inEdges[ i ] ].from ] != 1 ) {
+            return false;
+        }
+    }
+    return true;
+}
+
 /*
  * The pipelined case is a bit complicated for filling up the work queue. There
  * are two main stages: steady state operation setup, and pipeline draining 
@@ -45,33 +216,25 @@ Simulator::Simulator( Config * config ) {
  * stage. This way, during steady state pipeline operation, we always have the
  * pipeline running at max capacity without ever overfilling the pipeline.
  *
- * During the second stage the work queue filling is a bit more complex. We need
- * to pack numWorkItems % maxPipelineCapacity work items in as few queue spots
- * as possible while also never overfilling the pipeline. This is a bit tricky
- * and I cannot guarantee optimality of my approach, but the approach is
- * correct. The approach is to first add remainderOfWork / numStages work queue
- * elements of remainderOfWork / numStages work items each. Then, there still
- * might be remainderOfWork % numStages work items left to process, and I fill
- * the work queue with remainderOfWork % numStages 1s. 
+ * During the second stage we need to pack the remaining 
+ * numWorkItems % maxPipelineCapacity work items in as few queue spots as 
+ * possible while also never overfilling the pipeline. The approach is to fill
+ * the work queue with batches of maxPipelineCapacity / numStages work items,
+ * followed by one smaller batch with whatever work items are left over. Since
+ * no batch can be larger than maxPipelineCapacity / numStages, this uses the 
+ * fewest queue spots possible, and every work item is enqueued exactly once.
  *
  * The reason that the second stage will never overfill the pipeline is as 
  * follows:
  *
- * At the end of the first stage, the pipeline is at max capacity, with the next
- * item to be falling off the end of the pipeline being of value of 
- * maxPipelineCapacity / numStages. 
- *
- * At the start of the second stage, the first item being inserted has a maximum
- * value of max( ( numWorkItems % maxPipelineCapacity ) / numStages, 1 ). Now, 
- * since my pipeline implementation does not support bubbles, 
- * maxPipelineCapacity / numStages >= 1, so the second expression in the max
- * equation is safe.
- *
- * For the first expression in the max equation, it is enough to see that since
- * numWorkItems % maxPipelineCapacity has a range of 
- * [ 0, maxPipelineCapacity - 1 ], the first expression in the max equation can
- * never be greater than maxPipelineCapacity / numStages, so you can never 
- * overfill the pipeline.
+ * The pipeline holds the last numStages batches that entered it. During the
+ * first stage, any numStages consecutive batches add up to exactly 
+ * maxPipelineCapacity. Every batch of the second stage holds at most 
+ * maxPipelineCapacity / numStages work items, which is no more than the 
+ * batch of the first stage that it pushes out of the pipeline, so the 
+ * pipeline never holds more than maxPipelineCapacity work items. Since my 
+ * pipeline implementation does not support bubbles, 
+ * maxPipelineCapacity / numStages >= 1, so every batch makes progress.
  *
  * QED.
  *
@@ -102,13 +265,12 @@ void Simulator::setUpWorkQueueForConfig( bool pipe ) {
 
     if ( remainderOfWork ) {
         if ( pipe ) {
-            int perStageWorkItemsIterations = remainderOfWork / numStages;
-            for ( int i = 0; i < perStageWorkItemsIterations; i++ ) {
+            int perStageWorkItemsIterations = maxPipelineCapacity / numStages;
+            while ( remainderOfWork > perStageWorkItemsIterations ) {
                 workItems.push( perStageWorkItemsIterations );
+                remainderOfWork -= perStageWorkItemsIterations;
             }
-            for ( int i = 0; i < remainderOfWork % numStages; i++ ) {
-                workItems.push( 1 );
-            }
+            workItems.push( remainderOfWork );
         } else {
             workItems.push( remainderOfWork );
         }
@@ -116,35 +278,96 @@ void Simulator::setUpWorkQueueForConfig( bool pipe ) {
 }
 
 void Simulator::noPipelinerSimulation() {
+    // Without pipelining the control signals are only used to let the sync 
+    // joins know whether more items can still arrive from their predecessors.
+    // That only stops being the case once the last batch goes through.
+    resetRouting();
+    controlSignals = std::vector< int >( config->numStages(), 0 );
+    resetVirtualTime();
+    stageItemsProcessed = std::vector< int >( 
+            config->numStages() * falseSharingPreventionBuffer, 0 );
+
     while ( !workItems.empty() ) {
         int currentWorkItems = workItems.front();
         workItems.pop();
 
+        if ( workItems.empty() ) {
+            controlSignals = std::vector< int >( config->numStages(), 1 );
+        }
+
+        if ( pastDeadline() ) {
+            break;
+        }
+
+        // Going through the stages in order means that every stage runs after
+        // all of its predecessors have routed their outputs for this batch.
         for ( int stage = 0; stage < config->numStages(); stage++ ) {
-            for ( int workItem = 0; workItem < currentWorkItems; workItem++ ) {
-                // "Process" the work item
-                // In the case of the simulator, you "process" by sleeping for
-                // a specified amount of time. 
-                nanosleep( &( timespecs[ stage ] ), NULL );
+            int stageWorkItems = 
+                ( stage == 0 ) ? currentWorkItems : gatherStageInput( stage );
+            if ( !runStageSequentially( stage, stageWorkItems ) ) {
+                return;
+            }
+
+            // A sync join can still hold unpaired items after the last batch.
+            // Keep draining it until nothing more can reach it, the same way
+            // the pipelined controller does, before moving on to the stages
+            // after it.
+            while ( workItems.empty() && stage > 0 && !upstreamDone( stage ) ) {
+                if ( !runStageSequentially( stage, 
+                            gatherStageInput( stage ) ) ) {
+                    return;
+                }
             }
         }
     }
 }
 
-void Simulator::noPipelinerDriver( bool shortCircuit ) {
-    setUpWorkQueueForConfig( false );
+// Process one batch in a stage of the non pipelined run and route its output.
+// Returns false if the run went past its deadline.
+bool Simulator::runStageSequentially( int stage, int items ) {
+    processWorkItems( stage, items );
+    if ( hasDeadline() && pastDeadline() ) {
+        return false;
+    }
+    stageItemsProcessed[ stage * falseSharingPreventionBuffer ] += items;
 
-    std::cout << "Starting" << ( shortCircuit ? " " : " non " ) 
-        << "pipelined simulation" << std::endl;
+    // Without pipelining the stages run one after another, so the virtual 
+    // time of every stage adds up.
+    int slot = stage * falseSharingPreventionBuffer;
+    virtualClock += stageVirtualTime[ slot ];
+    stageVirtualTime[ slot ] = 0;
+
+    routeStageOutput( stage, items );
+    return true;
+}
+
+std::chrono::duration< double, std::milli > 
+Simulator::timeNoPipelinerSimulation() {
+    setUpWorkQueueForConfig( false );
 
     auto startTimer = std::chrono::high_resolution_clock::now();
+    startDeadline( startTimer );
     noPipelinerSimulation();
     auto endTimer = std::chrono::high_resolution_clock::now();
 
+    if ( config->virtualTime() ) {
+        return virtualDuration();
+    }
+    return endTimer - startTimer;
+}
+
+void Simulator::noPipelinerDriver( bool shortCircuit ) {
+    if ( metrics ) {
+        metrics->beginPhase( shortCircuit ? 1 : 0 );
+    }
+
+    std::cout << "Starting" << ( shortCircuit ? " " : " non " ) 
+        << "pipelined simulation" << std::endl;
+
     // Did you know that this below line of code is perfectly legal? I think it
     // shouldn't be, but at this point I am arguing with the C spec.
-    ( shortCircuit ? durationPipelined : durationNonPipelined ) = endTimer 
-        - startTimer;
+    ( shortCircuit ? durationPipelined : durationNonPipelined ) = 
+        timeNoPipelinerSimulation();
 
     // Print out the results. 
     std::cout << "\t" << ( shortCircuit ? "Pipelined" : "Non pipelined" ) 
@@ -157,57 +380,130 @@ void Simulator::noPipelinerDriver( bool shortCircuit ) {
         << " work items per second" << std::endl;
 }
             
-void Simulator::simulatorMain() {
-    setUpTimeSpecs();
-
-    // Run the non pipelined simulation first.
-    if ( !config->skipNoPipeline() ) {
-       noPipelinerDriver( false ); 
-    }
-
-    // If only one stage is provided, it's semantically equivalent to the non
-    // pipelined implementaion. 
-    if ( config->numStages() == 1 ) {
-        noPipelinerDriver( true );
-        std::cout << "Providing speedup data is not supported for a single"
-            << " stage pipeline" << std::endl;
-        return;
+void Simulator::pipelinerSimulation() {
+    // Setup for the threaded pipelined system run.
+    if ( metrics ) {
+        metrics->beginPhase( 1 );
     }
 
-    // This is part of the horribly disgusting hack I mentioned on line 11
-    shmemSimulatorHandle = this;
-
-    // Setup for the threaded pipelined system run.
+    leaveEventLoop = false;
+    controlIterations = 0;
     resetControlSignals();
+    resetRouting();
+    resetVirtualTime();
     setUpWorkQueueForConfig( true );
     TID = std::vector< pthread_t >( config->numStages() );
     stageInputs = std::vector< int >( 
             config->numStages() * falseSharingPreventionBuffer, 0 );
     stageOutputs = std::vector< int >( 
             config->numStages() * falseSharingPreventionBuffer, 0 );
+    stageItemsProcessed = std::vector< int >( 
+            config->numStages() * falseSharingPreventionBuffer, 0 );
 
     pthread_barrier_init( &barrier, NULL, config->numStages() );
     pthread_setconcurrency( config->numStages() );
-    int shortID[ config->numStages() ];
+    // Every thread gets a pointer to this simulator along with its stage, so
+    // that several simulators can run side by side in the same process.
+    std::vector< StageThreadArgs > stageThreadArgs( config->numStages() );
 
     for ( int i = 1; i < config->numStages(); i++ ) {
-        shortID[ i ] = i;
+        stageThreadArgs[ i ] = { this, i };
         pthread_create( &TID[ i ], NULL, pipelinerSimulatorMain, 
-                        &shortID[ i ] );
+                        &stageThreadArgs[ i ] );
     }
 
-    shortID[ 0 ] = 0;
+    stageThreadArgs[ 0 ] = { this, 0 };
 
-    std::cout << "Starting pipelined simulation" << std::endl;
-    
     // Time the simulation run from the "control" thread perspective.
     auto startTimer = std::chrono::high_resolution_clock::now();
-    pipelinerSimulatorMain( ( void * ) &( shortID[ 0 ] ) );
+    startDeadline( startTimer );
+    pipelinerSimulatorMain( ( void * ) &( stageThreadArgs[ 0 ] ) );
     auto endTimer = std::chrono::high_resolution_clock::now();
     durationPipelined = endTimer - startTimer;
+    if ( config->virtualTime() ) {
+        durationPipelined = virtualDuration();
+    }
+
+    for ( int i = 1; i < config->numStages(); i++ ) {
+        pthread_join( TID[ i ], NULL );
+    }
 
     pthread_barrier_destroy( &barrier );
-    
+}
+
+// Time only the pipelined run of the configuration, without printing anything.
+// A single stage pipeline is the same as the non pipelined run. 
+void Simulator::timePipelinedRun() {
+    setUpTimeSpecs();
+
+    if ( config->numStages() == 1 ) {
+        durationPipelined = timeNoPipelinerSimulation();
+        return;
+    }
+
+    pipelinerSimulation();
+}
+
+bool Simulator::hasDeadline() {
+    return timeBudget != std::chrono::duration< double, std::milli >::max();
+}
+
+bool Simulator::pastDeadline() {
+    if ( config->virtualTime() ) {
+        if ( virtualDuration() < timeBudget ) {
+            return false;
+        }
+    } else if ( std::chrono::high_resolution_clock::now() < deadline ) {
+        return false;
+    }
+    aborted = true;
+    return true;
+}
+
+void Simulator::startDeadline( 
+        std::chrono::high_resolution_clock::time_point start ) {
+    deadline = std::chrono::high_resolution_clock::time_point::max();
+    if ( hasDeadline() ) {
+        deadline = start + std::chrono::duration_cast< 
+            std::chrono::high_resolution_clock::duration >( timeBudget );
+    }
+}
+
+// Live metrics are only published for the duration of the simulations.
+void Simulator::simulatorMain() {
+    if ( config->metricsInterval() == 0 ) {
+        runSimulations();
+        return;
+    }
+
+    Metrics liveMetrics( config->numStages(), config->metricsInterval() );
+    metrics = &liveMetrics;
+    liveMetrics.start();
+    runSimulations();
+    liveMetrics.stop();
+    metrics = nullptr;
+}
+
+void Simulator::runSimulations() {
+    setUpTimeSpecs();
+
+    // Run the non pipelined simulation first.
+    if ( !config->skipNoPipeline() ) {
+       noPipelinerDriver( false ); 
+    }
+
+    // If only one stage is provided, it's semantically equivalent to the non
+    // pipelined implementaion. 
+    if ( config->numStages() == 1 ) {
+        noPipelinerDriver( true );
+        std::cout << "Providing speedup data is not supported for a single"
+            << " stage pipeline" << std::endl;
+        return;
+    }
+
+    std::cout << "Starting pipelined simulation" << std::endl;
+    pipelinerSimulation();
+
     // Print out the results. 
     std::cout << "\tPipelined time taken: " 
         << durationPipelined.count() << std::endl;
@@ -225,6 +521,66 @@ void Simulator::simulatorMain() {
             << " times faster than the non pipelined implementation." 
             << std::endl;
     }
+
+    if ( config->customTopology() ) {
+        reportCriticalPath();
+    }
+}
+
+static void printPath( std::vector< int > const & path ) {
+    for ( int i = 0; i < path.size(); i++ ) {
+        std::cout << ( i ? " -> " : "" ) << path[ i ] + 1;
+    }
+}
+
+/*
+ * Every iteration of the pipeline lasts as long as the slowest stage takes to
+ * process its batch, so the stage that spends the most time per work item 
+ * entering the pipeline bounds the throughput of the whole pipeline. The 
+ * critical path on the other hand bounds how quickly a single item can make 
+ * it through the pipeline.
+ */
+void Simulator::reportCriticalPath() {
+    std::vector< int > delays = topology.stageDelays();
+    std::vector< double > load = topology.expectedLoad();
+    std::vector< double > costs( config->numStages() );
+
+    // The cost of each stage is measured against the items that actually 
+    // entered the pipeline through the first stage.
+    double entered = stageItemsProcessed[ 0 ];
+
+    std::cout << "Critical path analysis:" << std::endl;
+    for ( int stage = 0; stage < config->numStages(); stage++ ) {
+        int processed = 
+            stageItemsProcessed[ stage * falseSharingPreventionBuffer ];
+        costs[ stage ] = ( double ) processed * delays[ stage ] / entered;
+        std::cout << "\tStage " << stage + 1 << ": delay " << delays[ stage ]
+            << " us, expected load " << load[ stage ] << ", processed " 
+            << processed << " items, " << costs[ stage ] 
+            << " us per work item" << std::endl;
+    }
+
+    std::vector< int > critical = topology.criticalPath();
+    int latency = 0;
+    for ( int i = 0; i < critical.size(); i++ ) {
+        latency += delays[ critical[ i ] ];
+    }
+    std::cout << "\tCritical path: ";
+    printPath( critical );
+    std::cout << " (" << latency << " us per item)" << std::endl;
+
+    std::vector< int > bottleneck = topology.bottleneckPath( costs );
+    int bottleneckStage = 0;
+    for ( int i = 0; i < bottleneck.size(); i++ ) {
+        if ( costs[ bottleneck[ i ] ] > costs[ bottleneckStage ] ) {
+            bottleneckStage = bottleneck[ i ];
+        }
+    }
+    std::cout << "\tThroughput is bound by stage " << bottleneckStage + 1 
+        << " on the branch ";
+    printPath( bottleneck );
+    std::cout << " (at most " << 1000000 / costs[ bottleneckStage ] 
+        << " work items per second)" << std::endl;
 }
 
 void Simulator::dumpDebugInfo( int state ) {
@@ -248,6 +604,11 @@ void Simulator::dumpDebugInfo( int state ) {
         std::cout << " " << controlSignals[ i ];
     }
     std::cout << std::endl;
+    std::cout << "\t edge pending:";
+    for ( int i = 0; i < edgePending.size(); i++ ) {
+        std::cout << " " << edgePending[ i ];
+    }
+    std::cout << std::endl;
     std::cout << "\t leaveEventLoop: " << ( leaveEventLoop ? "true" : "false" )
         << std::endl;
     if ( state ) {
@@ -255,19 +616,33 @@ void Simulator::dumpDebugInfo( int state ) {
     }
 }
 
+// Wait at the barrier, keeping track of how long the wait took when live 
+// metrics are on.
+void Simulator::waitAtBarrier( int tid ) {
+    if ( !metrics ) {
+        pthread_barrier_wait( &barrier );
+        return;
+    }
+
+    struct timespec waitStart;
+    clock_gettime( CLOCK_MONOTONIC, &waitStart );
+    pthread_barrier_wait( &barrier );
+    metrics->addBarrierWait( tid, nanosSince( waitStart ) );
+}
+
 static void * pipelinerSimulatorMain( void * arg ) {
-    int tid = *( int * ) arg;
+    Simulator * simulator = ( ( StageThreadArgs * ) arg )->simulator;
+    int tid = ( ( StageThreadArgs * ) arg )->tid;
 
     // Wait for all the threads to gather.
-    pthread_barrier_wait( &( shmemSimulatorHandle->barrier ) );
+    pthread_barrier_wait( &( simulator->barrier ) );
 
     // Pipeline initialization done by the control thread only, the rest 
     // can enter the main body loop.
-    if ( tid == shmemSimulatorHandle->controlThread ) {
-        shmemSimulatorHandle->stageInputs[ 0 ] = 
-            shmemSimulatorHandle->workItems.front();
-        shmemSimulatorHandle->workItems.pop();
-        shmemSimulatorHandle->controlSignals[ 0 ]++;
+    if ( tid == simulator->controlThread ) {
+        simulator->stageInputs[ 0 ] = simulator->workItems.front();
+        simulator->workItems.pop();
+        simulator->controlSignals[ 0 ]++;
     }
 
     // The logic for signaling to every thread that they should all break out
@@ -275,20 +650,20 @@ static void * pipelinerSimulatorMain( void * arg ) {
     // of barrier semantics, all threads *must* exit on the same iteration, as
     // otherwise we can have some threads that never wake while waiting at a 
     // barrier. 
-    while ( !shmemSimulatorHandle->leaveEventLoop ) {
+    while ( !simulator->leaveEventLoop ) {
         // Part 1: Let each thread execute it's stage.
-        shmemSimulatorHandle->simulateStage( tid );
+        simulator->simulateStage( tid );
 
         // Wait until all stages finish executing.
-        pthread_barrier_wait( &( shmemSimulatorHandle->barrier ) );
+        simulator->waitAtBarrier( tid );
 
         // Part 2: Control the pipeline.
-        if ( tid == shmemSimulatorHandle->controlThread ) {
-            shmemSimulatorHandle->controlPipeline();
+        if ( tid == simulator->controlThread ) {
+            simulator->controlPipeline();
         }
         
         // Wait until all stage execution is set up again.
-        pthread_barrier_wait( &( shmemSimulatorHandle->barrier ) );
+        simulator->waitAtBarrier( tid );
     }
 
     // This return is to get rid of a compiler warning.
@@ -304,15 +679,12 @@ void Simulator::simulateStage( int tid ) {
     // Assume control set up inputs for this stage already.
     int currentWorkItems = stageInputs[ tid * falseSharingPreventionBuffer ];
 
-    for ( int workItem = 0; workItem < currentWorkItems; workItem++ ) {
-        // "Process" the work item.
-        // In the case of the simulator, you "process" by sleeping for a 
-        // specified amount of time.
-        nanosleep( &( timespecs[ tid ] ), NULL );
-    }
+    processWorkItems( tid, currentWorkItems );
 
     // Set the stage output for control to pass to the next stage as input.
     stageOutputs[ tid * falseSharingPreventionBuffer ] = currentWorkItems;
+    stageItemsProcessed[ tid * falseSharingPreventionBuffer ] += 
+        currentWorkItems;
 }
 
 void Simulator::controlPipeline() {
@@ -323,8 +695,34 @@ void Simulator::controlPipeline() {
     // be called by a single thread only to avoid race conditions.
 
     dumpDebugInfo( 0 );
+    controlIterations++;
+
+    // Every stage waits at the barrier for the slowest one, so in virtual time
+    // an iteration lasts as long as its slowest stage.
+    long long iterationTime = 0;
+    for ( int stage = 0; stage < config->numStages(); stage++ ) {
+        iterationTime = std::max( iterationTime, 
+                stageVirtualTime[ stage * falseSharingPreventionBuffer ] );
+        stageVirtualTime[ stage * falseSharingPreventionBuffer ] = 0;
+    }
+    virtualClock += iterationTime;
 
-    // First control stage: Check if there are more work items to process in 
+    // Abandon the run if it is taking too long. Every thread leaves the event
+    // loop on the same iteration, so this is safe to do at any point.
+    if ( pastDeadline() ) {
+        leaveEventLoop = true;
+        return;
+    }
+
+    // First control stage: Move the stage outputs onto the edges leaving each
+    // stage, and clean up all the stage outputs.
+    for ( int stage = 0; stage < config->numStages(); stage++ ) {
+        routeStageOutput( stage, 
+                stageOutputs[ stage * falseSharingPreventionBuffer ] );
+        stageOutputs[ stage * falseSharingPreventionBuffer ] = 0;
+    }
+
+    // Second control stage: Check if there are more work items to process in 
     // the queue. If there are work items left to process, then give them to the
     // first stage.
     if ( workItems.empty() ) {
@@ -336,42 +734,30 @@ void Simulator::controlPipeline() {
         workItems.pop();
     }
 
-    // Second control stage: Put previous stage outputs as the inputs for the 
-    // next stage for each stage.
+    // Third control stage: Gather the inputs for each stage from its incoming
+    // edges. Stages that are not started yet but have inputs to process get 
+    // started, and stages that will never get another input get turned off. 
+    // Going through the stages in order means that the control signals of the
+    // predecessors of a stage are already up to date.
     for ( int stage = 1; stage < config->numStages(); stage++ ) {
-        stageInputs[ stage * falseSharingPreventionBuffer ] = 
-            stageOutputs[ ( stage - 1 ) * falseSharingPreventionBuffer ];
-    }
-
-    // Third control stage: Clean up all the stage outputs. Note that this is
-    // the only loop that starts from 0 in this function!
-    for ( int stage = 0; stage < config->numStages(); stage++ ) {
-        stageOutputs[ ( stage ) * falseSharingPreventionBuffer ] = 0;
-    }
+        int input = gatherStageInput( stage );
+        stageInputs[ stage * falseSharingPreventionBuffer ] = input;
 
-    // Fourth control stage: Start the pipeline stages if they are not started
-    // yet but have inputs to process.
-    for ( int stage = 1; stage < config->numStages(); stage++ ) {
-        if ( controlSignals[ stage ] == -1 
-                && stageInputs[ stage * falseSharingPreventionBuffer ] != 0 ) {
+        if ( controlSignals[ stage ] == -1 && input != 0 ) {
             controlSignals[ stage ] = 0;
-        }
-    }
-
-    // Fifth control stage: If there is no input to process for a stage that has
-    // been started before, then turn off the stage.
-    for ( int stage = 1; stage < config->numStages(); 
-            stage++ ) {
-        if ( controlSignals[ stage ] == 0
-                && stageInputs[ stage * falseSharingPreventionBuffer ] == 0 ) {
+        } else if ( controlSignals[ stage ] != 1 && input == 0 
+                && upstreamDone( stage ) ) {
             controlSignals[ stage ] = 1;
         }
     }
 
-    // Sixth control stage: If the last pipeline stage is finished processing 
+    // Fourth control stage: If every pipeline stage is finished processing 
     // everything, then signal to the "event" loop to break.
-    if ( controlSignals[ config->numStages() - 1 ] == 1 ) {
-        leaveEventLoop = true;
+    leaveEventLoop = true;
+    for ( int stage = 0; stage < config->numStages(); stage++ ) {
+        if ( controlSignals[ stage ] != 1 ) {
+            leaveEventLoop = false;
+        }
     }
 
     // Pipeline control is done.
@@ -0,0 +1,140 @@
+#include "topology.h"
+#include "config.h"
+#include <vector>
+
+Topology::Topology( Config * config ) {
+    this->config = config;
+    edges = config->edges();
+    joinModes = config->joinModes();
+    inEdges = std::vector< std::vector< int > >( config->numStages() );
+    outEdges = std::vector< std::vector< int > >( config->numStages() );
+    for ( int i = 0; i < edges.size(); i++ ) {
+        outEdges[ edges[ i ].from ].push_back( i );
+        inEdges[ edges[ i ].to ].push_back( i );
+    }
+}
+
+int Topology::numEdgesWithRouting( int stage, Routing routing ) {
+    int count = 0;
+    for ( int i = 0; i < outEdges[ stage ].size(); i++ ) {
+        if ( edges[ outEdges[ stage ][ i ] ].routing == routing ) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// The time to "process" a single work item in each stage, in micro seconds.
+std::vector< int > Topology::stageDelays() {
+    std::vector< int > delays( config->numStages() );
+    for ( int i = 0; i < config->numStages(); i++ ) {
+        delays[ i ] = config->baseDelay() + config->imbalanceFactor()[ i ];
+    }
+    return delays;
+}
+
+// The number of items an edge carries for every work item that enters the 
+// first stage, given the expected load of the stage the edge leaves.
+double Topology::edgeLoad( int edge, std::vector< double > & load ) {
+    double incoming = load[ edges[ edge ].from ];
+    if ( edges[ edge ].routing != Routing::Broadcast ) {
+        incoming /= numEdgesWithRouting( edges[ edge ].from, 
+                edges[ edge ].routing );
+    }
+    return incoming;
+}
+
+/*
+ * The expected load of a stage is the number of items that stage processes 
+ * for every work item that enters the first stage. Broadcasting keeps the load
+ * the same on every edge, while splitting and round robin divide the load 
+ * between the edges that share the routing. 
+ *
+ * A merge join processes everything arriving on any edge, so its load is the 
+ * sum of the incoming loads. A sync join pairs items up across the edges, 
+ * and the edges that run dry are dropped from the pairing once their 
+ * predecessor is done, so its load is the largest of the incoming loads.
+ */
+std::vector< double > Topology::expectedLoad() {
+    std::vector< double > load( config->numStages(), 0 );
+    load[ 0 ] = 1;
+    for ( int stage = 1; stage < config->numStages(); stage++ ) {
+        for ( int i = 0; i < inEdges[ stage ].size(); i++ ) {
+            double incoming = edgeLoad( inEdges[ stage ][ i ], load );
+
+            if ( joinModes[ stage ] == JoinMode::Merge ) {
+                load[ stage ] += incoming;
+            } else if ( incoming > load[ stage ] ) {
+                load[ stage ] = incoming;
+            }
+        }
+    }
+    return load;
+}
+
+// The critical path is the path from the first stage to a stage without 
+// outgoing edges that takes the longest for a single item to travel through.
+std::vector< int > Topology::criticalPath() {
+    std::vector< int > delays = stageDelays();
+    std::vector< long long > latency( config->numStages(), 0 );
+    std::vector< int > parent( config->numStages(), -1 );
+
+    for ( int stage = 0; stage < config->numStages(); stage++ ) {
+        for ( int i = 0; i < inEdges[ stage ].size(); i++ ) {
+            int from = edges[ inEdges[ stage ][ i ] ].from;
+            if ( parent[ stage ] == -1 || latency[ from ] > latency[ stage ] ) {
+                latency[ stage ] = latency[ from ];
+                parent[ stage ] = from;
+            }
+        }
+        latency[ stage ] += delays[ stage ];
+    }
+
+    int last = 0;
+    for ( int stage = 0; stage < config->numStages(); stage++ ) {
+        if ( outEdges[ stage ].empty() && latency[ stage ] > latency[ last ] ) {
+            last = stage;
+        }
+    }
+
+    std::vector< int > path;
+    for ( int stage = last; stage != -1; stage = parent[ stage ] ) {
+        path.insert( path.begin(), stage );
+    }
+    return path;
+}
+
+// The branch that bounds throughput is the one going through the stage with
+// the highest cost. The path is extended from that stage towards both ends by
+// always following the most expensive neighbour.
+std::vector< int > Topology::bottleneckPath( std::vector< double > & costs ) {
+    int bottleneck = 0;
+    for ( int stage = 1; stage < config->numStages(); stage++ ) {
+        if ( costs[ stage ] > costs[ bottleneck ] ) {
+            bottleneck = stage;
+        }
+    }
+
+    std::vector< int > path( 1, bottleneck );
+    while ( !inEdges[ path.front() ].empty() ) {
+        int best = edges[ inEdges[ path.front() ][ 0 ] ].from;
+        for ( int i = 1; i < inEdges[ path.front() ].size(); i++ ) {
+            int from = edges[ inEdges[ path.front() ][ i ] ].from;
+            if ( costs[ from ] > costs[ best ] ) {
+                best = from;
+            }
+        }
+        path.insert( path.begin(), best );
+    }
+    while ( !outEdges[ path.back() ].empty() ) {
+        int best = edges[ outEdges[ path.back() ][ 0 ] ].to;
+        for ( int i = 1; i < outEdges[ path.back() ].size(); i++ ) {
+            int to = edges[ outEdges[ path.back() ][ i ] ].to;
+            if ( costs[ to ] > costs[ best ] ) {
+                best = to;
+            }
+        }
+        path.push_back( best );
+    }
+    return path;
+}